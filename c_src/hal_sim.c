@@ -0,0 +1,811 @@
+// SPDX-FileCopyrightText: 2026 agent
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Simulated spidev HAL
+//
+// This HAL behaves like the Linux spidev driver with emulated peripherals
+// attached. Unlike hal_stub.c, transfers take time. Each ioctl is charged a
+// fixed syscall overhead, the wire time for the bits at `speed_hz`, and the
+// `delay_us` that spidev inserts after each transfer. Transfers are split into
+// `bufsiz`-sized ioctls just like the real driver, and chip select is
+// deasserted between them so peripherals see the same framing that hardware
+// would.
+//
+// Opening the same device name more than once connects to the same emulated
+// peripheral. Its state lasts until the last handle to it is closed. Devices
+// named `spidevB.C` share bus `B` with the other chip selects on it, and all
+// other names get a bus to themselves. Like spidev, each ioctl holds the bus
+// for its wire time, so concurrent users contend for it and can interleave
+// between the chunks of a large transfer. The syscall overhead doesn't hold
+// the bus.
+//
+// The peripheral is picked by the device name:
+//
+// * `sim_mcp3008` - MCP3008 8-channel 10-bit ADC
+// * `sim_flash`   - 1 MiB SPI NOR flash with status register and busy timing
+// * `sim_regs`    - 128 byte register file (bit 7 of first byte set for reads)
+// * anything else - loopback like the stub HAL
+//
+// The following environment variables are read the first time the simulator
+// is used:
+//
+// * `CIRCUITS_SPI_SIM_BUFSIZ` - max bytes per ioctl (default 4096)
+// * `CIRCUITS_SPI_SIM_IOCTL_US` - per-ioctl overhead in microseconds (default 20)
+//
+// `CIRCUITS_SPI_SIM_MCP3008` holds comma-separated channel readings (0-1023)
+// and is read when the ADC is powered up by the first open.
+
+#include "spi_nif.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// Sleep until this close to the deadline, then spin to absorb wakeup latency
+#define SIM_SPIN_NS 10000ULL
+
+#define SIM_DEFAULT_BUFSIZ 4096
+#define SIM_MAX_BUFSIZ (16 * 1024 * 1024)
+#define SIM_DEFAULT_IOCTL_US 20
+#define SIM_MAX_IOCTL_US 1000000
+
+#define MCP3008_CHANNELS 8
+
+#define FLASH_SIZE (1024 * 1024)
+#define FLASH_PAGE_SIZE 256
+#define FLASH_STATUS_BUSY 0x01
+#define FLASH_STATUS_WEL 0x02
+
+// Typical W25Q80 timings
+#define FLASH_PAGE_PROGRAM_NS 700000ULL
+#define FLASH_SECTOR_ERASE_NS 45000000ULL
+#define FLASH_BLOCK_ERASE_NS 150000000ULL
+#define FLASH_CHIP_ERASE_NS 2000000000ULL
+
+#define REGS_SIZE 128
+#define REGS_WHO_AM_I 0x5a
+
+enum sim_peripheral {
+    SIM_LOOPBACK,
+    SIM_MCP3008,
+    SIM_FLASH,
+    SIM_REGS
+};
+
+struct Mcp3008 {
+    unsigned int values[MCP3008_CHANNELS];
+    int started;
+    int config_bits;
+    unsigned int config;
+    int out_bit;
+    unsigned int sample;
+};
+
+struct Flash {
+    uint8_t *data;
+    uint8_t status;
+    uint64_t busy_until;
+    uint8_t cmd;
+    size_t index;
+    uint32_t addr;
+    uint8_t page[FLASH_PAGE_SIZE];
+    int page_written[FLASH_PAGE_SIZE];
+};
+
+struct Regs {
+    uint8_t regs[REGS_SIZE];
+    size_t index;
+    int reading;
+    uint8_t addr;
+};
+
+// One per bus and shared by its devices
+struct SimBus {
+    struct SimBus *next;
+    char name[32];
+
+    // Devices on the bus. Protected by devices_lock.
+    int refcount;
+
+    // Held for each ioctl like spidev's bus lock
+    pthread_mutex_t lock;
+};
+
+// One per device name and shared by all handles that open it
+struct SimDevice {
+    struct SimDevice *next;
+    char name[32];
+
+    // Open handles plus in-flight transfers. Protected by devices_lock.
+    int refcount;
+
+    // Device state is protected by the bus lock
+    struct SimBus *bus;
+
+    enum sim_peripheral peripheral;
+    union {
+        struct Mcp3008 adc;
+        struct Flash flash;
+        struct Regs regs;
+    } u;
+};
+
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct SimBus *buses;
+static struct SimDevice *devices;
+
+// Open handles index into this table. It grows as needed.
+static struct SimDevice **handles;
+static int handles_size;
+
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+static unsigned int sim_bufsiz;
+static unsigned int sim_ioctl_us;
+
+// Totals across all devices for load tests
+static uint64_t stat_ioctls;
+static uint64_t stat_bytes;
+static uint64_t stat_bus_time_ns;
+
+static uint64_t sim_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void sim_wait_until(uint64_t deadline)
+{
+#ifdef __linux__
+    // The default 50us timer slack would swamp short ioctl costs
+    static __thread int slack_set = 0;
+    if (!slack_set) {
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+        slack_set = 1;
+    }
+#endif
+
+    uint64_t now = sim_now_ns();
+    if (deadline > now + SIM_SPIN_NS) {
+        struct timespec ts;
+#ifdef __linux__
+        uint64_t wake = deadline - SIM_SPIN_NS;
+        ts.tv_sec = (time_t) (wake / 1000000000ULL);
+        ts.tv_nsec = (long) (wake % 1000000000ULL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+#else
+        uint64_t duration = deadline - SIM_SPIN_NS - now;
+        ts.tv_sec = (time_t) (duration / 1000000000ULL);
+        ts.tv_nsec = (long) (duration % 1000000000ULL);
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+            ;
+#endif
+    }
+
+    while (sim_now_ns() < deadline)
+        ;
+}
+
+static unsigned int env_uint(const char *name,
+                             unsigned int default_value,
+                             unsigned int min_value,
+                             unsigned int max_value)
+{
+    const char *str = getenv(name);
+    if (str == NULL || *str == '\0')
+        return default_value;
+
+    // strtoul accepts signs and whitespace, so require a digit up front
+    char *end;
+    errno = 0;
+    unsigned long value = isdigit((unsigned char) *str) ? strtoul(str, &end, 10) : 0;
+    if (!isdigit((unsigned char) *str) || *end != '\0' || errno != 0 ||
+            value < min_value || value > max_value) {
+        error("circuits_spi: ignoring invalid %s=%s", name, str);
+        return default_value;
+    }
+
+    return (unsigned int) value;
+}
+
+static void config_init()
+{
+    sim_bufsiz = env_uint("CIRCUITS_SPI_SIM_BUFSIZ", SIM_DEFAULT_BUFSIZ, 1, SIM_MAX_BUFSIZ);
+    sim_ioctl_us = env_uint("CIRCUITS_SPI_SIM_IOCTL_US", SIM_DEFAULT_IOCTL_US, 0, SIM_MAX_IOCTL_US);
+}
+
+static void load_config()
+{
+    pthread_once(&config_once, config_init);
+}
+
+static uint64_t wire_time_ns(const struct SpiConfig *config, size_t len)
+{
+    // spidev packs words larger than 8 bits into 2 or 4 bytes
+    unsigned int bytes_per_word = config->bits_per_word <= 8 ? 1 : (config->bits_per_word <= 16 ? 2 : 4);
+    uint64_t words = (len + bytes_per_word - 1) / bytes_per_word;
+    uint64_t bits = words * config->bits_per_word;
+
+    return bits * 1000000000ULL / config->speed_hz;
+}
+
+static ERL_NIF_TERM make_u64(ErlNifEnv *env, uint64_t value)
+{
+    return enif_make_uint64(env, (ErlNifUInt64) value);
+}
+
+ERL_NIF_TERM hal_info(ErlNifEnv *env)
+{
+    load_config();
+
+    ERL_NIF_TERM info = enif_make_new_map(env);
+    enif_make_map_put(env, info, enif_make_atom(env, "name"), enif_make_atom(env, "sim"), &info);
+    enif_make_map_put(env, info, enif_make_atom(env, "bufsiz"), enif_make_uint(env, sim_bufsiz), &info);
+    enif_make_map_put(env, info, enif_make_atom(env, "ioctl_overhead_us"),
+                      enif_make_uint(env, sim_ioctl_us), &info);
+    enif_make_map_put(env, info, enif_make_atom(env, "ioctls"),
+                      make_u64(env, __atomic_load_n(&stat_ioctls, __ATOMIC_RELAXED)), &info);
+    enif_make_map_put(env, info, enif_make_atom(env, "bytes_transferred"),
+                      make_u64(env, __atomic_load_n(&stat_bytes, __ATOMIC_RELAXED)), &info);
+    enif_make_map_put(env, info, enif_make_atom(env, "bus_time_us"),
+                      make_u64(env, __atomic_load_n(&stat_bus_time_ns, __ATOMIC_RELAXED) / 1000), &info);
+    return info;
+}
+
+ERL_NIF_TERM hal_max_transfer_size(ErlNifEnv *env)
+{
+    load_config();
+    return enif_make_uint(env, sim_bufsiz);
+}
+
+static void mcp3008_init(struct Mcp3008 *adc)
+{
+    // Default to a ramp so each channel is distinguishable
+    for (int i = 0; i < MCP3008_CHANNELS; i++)
+        adc->values[i] = (unsigned int) i * 128;
+
+    const char *env = getenv("CIRCUITS_SPI_SIM_MCP3008");
+    if (env == NULL || *env == '\0')
+        return;
+
+    unsigned int values[MCP3008_CHANNELS];
+    const char *str = env;
+    int count = 0;
+    for (;;) {
+        char *end;
+        errno = 0;
+        unsigned long value = isdigit((unsigned char) *str) ? strtoul(str, &end, 10) : 0;
+        if (!isdigit((unsigned char) *str) || errno != 0 || value > 1023 ||
+                count == MCP3008_CHANNELS || (*end != ',' && *end != '\0')) {
+            error("circuits_spi: ignoring invalid CIRCUITS_SPI_SIM_MCP3008=%s", env);
+            return;
+        }
+        values[count++] = (unsigned int) value;
+
+        if (*end == '\0')
+            break;
+        str = end + 1;
+    }
+
+    memcpy(adc->values, values, count * sizeof(unsigned int));
+}
+
+static void mcp3008_select(struct Mcp3008 *adc)
+{
+    adc->started = 0;
+    adc->config_bits = 0;
+    adc->config = 0;
+    adc->out_bit = 0;
+}
+
+static unsigned int mcp3008_clock(struct Mcp3008 *adc, unsigned int copi)
+{
+    if (!adc->started) {
+        // Leading zeros are ignored until the start bit
+        adc->started = copi;
+        return 0;
+    }
+
+    if (adc->config_bits < 4) {
+        // SGL/DIFF, D2, D1, D0
+        adc->config = (adc->config << 1) | copi;
+        adc->config_bits++;
+        if (adc->config_bits == 4) {
+            unsigned int channel = adc->config & 0x7;
+            if (adc->config & 0x8) {
+                adc->sample = adc->values[channel];
+            } else {
+                // Pseudo-differential: IN+ is the even/odd pair member selected
+                int plus = adc->values[channel];
+                int minus = adc->values[channel ^ 1];
+                adc->sample = plus > minus ? (unsigned int) (plus - minus) : 0;
+            }
+        }
+        return 0;
+    }
+
+    // Sample clock, null bit, B9..B0 MSB first, then B1..B9 LSB first
+    int n = adc->out_bit++;
+    if (n < 2)
+        return 0;
+    else if (n < 12)
+        return (adc->sample >> (11 - n)) & 1;
+    else if (n < 21)
+        return (adc->sample >> (n - 11)) & 1;
+    else
+        return 0;
+}
+
+static uint8_t mcp3008_byte(struct Mcp3008 *adc, uint8_t copi)
+{
+    uint8_t cipo = 0;
+    for (int bit = 7; bit >= 0; bit--)
+        cipo |= (uint8_t) (mcp3008_clock(adc, (copi >> bit) & 1) << bit);
+    return cipo;
+}
+
+static int flash_busy(struct Flash *flash)
+{
+    if (flash->busy_until != 0 && sim_now_ns() >= flash->busy_until) {
+        flash->busy_until = 0;
+        flash->status &= (uint8_t) ~(FLASH_STATUS_BUSY | FLASH_STATUS_WEL);
+    }
+    return flash->busy_until != 0;
+}
+
+static void flash_start_busy(struct Flash *flash, uint64_t duration_ns)
+{
+    flash->status |= FLASH_STATUS_BUSY;
+    flash->busy_until = sim_now_ns() + duration_ns;
+}
+
+static void flash_select(struct Flash *flash)
+{
+    flash->cmd = 0;
+    flash->index = 0;
+    flash->addr = 0;
+    memset(flash->page_written, 0, sizeof(flash->page_written));
+}
+
+static uint8_t flash_byte(struct Flash *flash, uint8_t copi)
+{
+    size_t index = flash->index++;
+
+    if (index == 0) {
+        flash->cmd = copi;
+
+        // Only the status register can be read while busy
+        if (flash_busy(flash) && copi != 0x05)
+            flash->cmd = 0;
+
+        switch (flash->cmd) {
+        case 0x06: // Write enable
+            flash->status |= FLASH_STATUS_WEL;
+            break;
+        case 0x04: // Write disable
+            flash->status &= (uint8_t) ~FLASH_STATUS_WEL;
+            break;
+        default:
+            break;
+        }
+        return 0xff;
+    }
+
+    switch (flash->cmd) {
+    case 0x05: // Read status register 1
+        flash_busy(flash);
+        return flash->status;
+
+    case 0x9f: { // JEDEC ID
+        static const uint8_t jedec_id[] = {0xef, 0x40, 0x14};
+        return index <= sizeof(jedec_id) ? jedec_id[index - 1] : 0xff;
+    }
+
+    case 0x03: // Read data
+    case 0x0b: // Fast read
+    case 0x02: // Page program
+    case 0x20: // Sector erase
+    case 0xd8: // Block erase
+        if (index <= 3) {
+            flash->addr = ((flash->addr << 8) | copi) & (FLASH_SIZE - 1);
+            return 0xff;
+        }
+        if (flash->cmd == 0x03 || (flash->cmd == 0x0b && index > 4)) {
+            uint8_t data = flash->data[flash->addr];
+            flash->addr = (flash->addr + 1) & (FLASH_SIZE - 1);
+            return data;
+        }
+        if (flash->cmd == 0x02) {
+            // Page programs wrap at the end of the page
+            size_t offset = (flash->addr + index - 4) % FLASH_PAGE_SIZE;
+            flash->page[offset] = copi;
+            flash->page_written[offset] = 1;
+        }
+        return 0xff;
+
+    default:
+        return 0xff;
+    }
+}
+
+static void flash_deselect(struct Flash *flash)
+{
+    // Program and erase operations start when chip select goes high
+    if (!(flash->status & FLASH_STATUS_WEL) || flash_busy(flash))
+        return;
+
+    switch (flash->cmd) {
+    case 0x02:
+        if (flash->index > 4) {
+            uint32_t page_base = flash->addr & ~(uint32_t) (FLASH_PAGE_SIZE - 1);
+            for (size_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+                if (flash->page_written[i])
+                    flash->data[page_base + i] &= flash->page[i];
+            }
+            flash_start_busy(flash, FLASH_PAGE_PROGRAM_NS);
+        }
+        break;
+    case 0x20:
+        if (flash->index == 4) {
+            memset(&flash->data[flash->addr & ~(uint32_t) 0xfff], 0xff, 0x1000);
+            flash_start_busy(flash, FLASH_SECTOR_ERASE_NS);
+        }
+        break;
+    case 0xd8:
+        if (flash->index == 4) {
+            memset(&flash->data[flash->addr & ~(uint32_t) 0xffff], 0xff, 0x10000);
+            flash_start_busy(flash, FLASH_BLOCK_ERASE_NS);
+        }
+        break;
+    case 0xc7:
+    case 0x60:
+        if (flash->index == 1) {
+            memset(flash->data, 0xff, FLASH_SIZE);
+            flash_start_busy(flash, FLASH_CHIP_ERASE_NS);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void regs_select(struct Regs *regs)
+{
+    regs->index = 0;
+}
+
+static uint8_t regs_byte(struct Regs *regs, uint8_t copi)
+{
+    if (regs->index++ == 0) {
+        regs->reading = (copi & 0x80) != 0;
+        regs->addr = copi & 0x7f;
+        return 0;
+    }
+
+    uint8_t addr = regs->addr;
+    regs->addr = (regs->addr + 1) & 0x7f;
+
+    if (regs->reading)
+        return regs->regs[addr];
+
+    // Register 0 is a read-only ID
+    if (addr != 0)
+        regs->regs[addr] = copi;
+    return 0;
+}
+
+// Call with devices_lock held
+static struct SimBus *acquire_bus(const char *device_name)
+{
+    // spidevB.C shares bus B with the other chip selects
+    char name[32];
+    unsigned int bus_number, cs;
+    int n = 0;
+    if (sscanf(device_name, "spidev%u.%u%n", &bus_number, &cs, &n) == 2 && device_name[n] == '\0')
+        snprintf(name, sizeof(name), "spidev%u", bus_number);
+    else
+        snprintf(name, sizeof(name), "%s", device_name);
+
+    struct SimBus *bus = buses;
+    while (bus != NULL && strcmp(bus->name, name) != 0)
+        bus = bus->next;
+
+    if (bus == NULL) {
+        bus = enif_alloc(sizeof(struct SimBus));
+        if (bus == NULL)
+            return NULL;
+
+        memset(bus, 0, sizeof(*bus));
+        snprintf(bus->name, sizeof(bus->name), "%s", name);
+        pthread_mutex_init(&bus->lock, NULL);
+        bus->next = buses;
+        buses = bus;
+    }
+
+    bus->refcount++;
+    return bus;
+}
+
+// Call with devices_lock held
+static void release_bus(struct SimBus *bus)
+{
+    if (--bus->refcount > 0)
+        return;
+
+    struct SimBus **prev = &buses;
+    while (*prev != bus)
+        prev = &(*prev)->next;
+    *prev = bus->next;
+
+    pthread_mutex_destroy(&bus->lock);
+    enif_free(bus);
+}
+
+// Call with devices_lock held
+static struct SimDevice *new_device(const char *name)
+{
+    struct SimDevice *dev = enif_alloc(sizeof(struct SimDevice));
+    if (dev == NULL)
+        return NULL;
+
+    memset(dev, 0, sizeof(*dev));
+    snprintf(dev->name, sizeof(dev->name), "%s", name);
+
+    if (strcmp(name, "sim_mcp3008") == 0) {
+        dev->peripheral = SIM_MCP3008;
+        mcp3008_init(&dev->u.adc);
+    } else if (strcmp(name, "sim_flash") == 0) {
+        dev->peripheral = SIM_FLASH;
+        dev->u.flash.data = enif_alloc(FLASH_SIZE);
+        if (dev->u.flash.data == NULL) {
+            enif_free(dev);
+            return NULL;
+        }
+        memset(dev->u.flash.data, 0xff, FLASH_SIZE);
+    } else if (strcmp(name, "sim_regs") == 0) {
+        dev->peripheral = SIM_REGS;
+        dev->u.regs.regs[0] = REGS_WHO_AM_I;
+    } else {
+        dev->peripheral = SIM_LOOPBACK;
+    }
+
+    dev->bus = acquire_bus(name);
+    if (dev->bus == NULL) {
+        if (dev->peripheral == SIM_FLASH)
+            enif_free(dev->u.flash.data);
+        enif_free(dev);
+        return NULL;
+    }
+
+    return dev;
+}
+
+// Call with devices_lock held
+static void release_device(struct SimDevice *dev)
+{
+    if (--dev->refcount > 0)
+        return;
+
+    struct SimDevice **prev = &devices;
+    while (*prev != dev)
+        prev = &(*prev)->next;
+    *prev = dev->next;
+
+    release_bus(dev->bus);
+    if (dev->peripheral == SIM_FLASH)
+        enif_free(dev->u.flash.data);
+    enif_free(dev);
+}
+
+// Call with devices_lock held
+static int add_handle(struct SimDevice *dev)
+{
+    for (int fd = 0; fd < handles_size; fd++) {
+        if (handles[fd] == NULL) {
+            handles[fd] = dev;
+            return fd;
+        }
+    }
+
+    int new_size = handles_size ? handles_size * 2 : 16;
+    struct SimDevice **new_handles = enif_realloc(handles, new_size * sizeof(struct SimDevice *));
+    if (new_handles == NULL)
+        return -1;
+
+    memset(&new_handles[handles_size], 0, (new_size - handles_size) * sizeof(struct SimDevice *));
+    handles = new_handles;
+
+    int fd = handles_size;
+    handles_size = new_size;
+    handles[fd] = dev;
+    return fd;
+}
+
+int hal_spi_open(const char *device_path,
+                 struct SpiConfig *config,
+                 char *error_str)
+{
+    *error_str = '\0';
+
+    // Check the same things that spidev's ioctls would reject
+    if (config->mode > 3) {
+        strcpy(error_str, "invalid_mode");
+        return -1;
+    }
+    if (config->bits_per_word == 0)
+        config->bits_per_word = 8;
+    if (config->bits_per_word > 32) {
+        strcpy(error_str, "invalid_bits_per_word");
+        return -1;
+    }
+    if (config->speed_hz == 0) {
+        strcpy(error_str, "invalid_speed");
+        return -1;
+    }
+
+    load_config();
+
+    // Emulate bit reversal in software like most spidev controllers
+    config->sw_lsb_first = config->lsb_first;
+    config->max_transfer_size = sim_bufsiz;
+
+    const char *name = strrchr(device_path, '/');
+    name = name ? name + 1 : device_path;
+
+    pthread_mutex_lock(&devices_lock);
+
+    struct SimDevice *dev = devices;
+    while (dev != NULL && strcmp(dev->name, name) != 0)
+        dev = dev->next;
+
+    if (dev == NULL) {
+        dev = new_device(name);
+        if (dev == NULL) {
+            pthread_mutex_unlock(&devices_lock);
+            strcpy(error_str, "alloc_failed");
+            return -1;
+        }
+        dev->next = devices;
+        devices = dev;
+    }
+    dev->refcount++;
+
+    int fd = add_handle(dev);
+    if (fd < 0) {
+        release_device(dev);
+        strcpy(error_str, "alloc_failed");
+    }
+
+    pthread_mutex_unlock(&devices_lock);
+
+    return fd;
+}
+
+void hal_spi_close(int fd)
+{
+    pthread_mutex_lock(&devices_lock);
+    if (fd >= 0 && fd < handles_size && handles[fd] != NULL) {
+        // In-flight transfers hold their own reference
+        release_device(handles[fd]);
+        handles[fd] = NULL;
+    }
+    pthread_mutex_unlock(&devices_lock);
+}
+
+static void exchange(struct SimDevice *dev,
+                     const uint8_t *to_write,
+                     uint8_t *to_read,
+                     size_t len)
+{
+    if (dev->peripheral == SIM_LOOPBACK) {
+        if (to_read != NULL && to_write != NULL)
+            memcpy(to_read, to_write, len);
+        else if (to_read != NULL)
+            memset(to_read, 0, len);
+        return;
+    }
+
+    switch (dev->peripheral) {
+    case SIM_MCP3008:
+        mcp3008_select(&dev->u.adc);
+        break;
+    case SIM_FLASH:
+        flash_select(&dev->u.flash);
+        break;
+    default:
+        regs_select(&dev->u.regs);
+        break;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        // spidev clocks out zeros when there's nothing to write
+        uint8_t copi = to_write ? to_write[i] : 0;
+        uint8_t cipo;
+
+        switch (dev->peripheral) {
+        case SIM_MCP3008:
+            cipo = mcp3008_byte(&dev->u.adc, copi);
+            break;
+        case SIM_FLASH:
+            cipo = flash_byte(&dev->u.flash, copi);
+            break;
+        default:
+            cipo = regs_byte(&dev->u.regs, copi);
+            break;
+        }
+
+        if (to_read)
+            to_read[i] = cipo;
+    }
+
+    if (dev->peripheral == SIM_FLASH)
+        flash_deselect(&dev->u.flash);
+}
+
+static void sim_ioctl(struct SimDevice *dev,
+                      const struct SpiConfig *config,
+                      const uint8_t *to_write,
+                      uint8_t *to_read,
+                      size_t len)
+{
+    // Syscall overhead is spent before getting the bus
+    sim_wait_until(sim_now_ns() + (uint64_t) sim_ioctl_us * 1000);
+
+    // spidev's delay_usecs field is only 16 bits
+    uint64_t bus_ns = wire_time_ns(config, len) + (uint64_t) (uint16_t) config->delay_us * 1000;
+
+    pthread_mutex_lock(&dev->bus->lock);
+    uint64_t start = sim_now_ns();
+    exchange(dev, to_write, to_read, len);
+    sim_wait_until(start + bus_ns);
+    pthread_mutex_unlock(&dev->bus->lock);
+
+    __atomic_fetch_add(&stat_ioctls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_bytes, len, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat_bus_time_ns, bus_ns, __ATOMIC_RELAXED);
+}
+
+int hal_spi_transfer(int fd,
+                     const struct SpiConfig *config,
+                     const uint8_t *to_write,
+                     uint8_t *to_read,
+                     size_t len)
+{
+    // Hold a reference so that a concurrent close can't free the device
+    pthread_mutex_lock(&devices_lock);
+    struct SimDevice *dev = (fd >= 0 && fd < handles_size) ? handles[fd] : NULL;
+    if (dev != NULL)
+        dev->refcount++;
+    pthread_mutex_unlock(&devices_lock);
+
+    if (dev == NULL)
+        return -1;
+
+    const uint8_t *w = to_write;
+    uint8_t *r = to_read;
+    unsigned int max_len = config->max_transfer_size;
+
+    size_t len_left = len;
+    while (len_left > max_len) {
+        sim_ioctl(dev, config, w, r, max_len);
+
+        if (w)
+            w += max_len;
+        if (r)
+            r += max_len;
+        len_left -= max_len;
+    }
+    sim_ioctl(dev, config, w, r, len_left);
+
+    pthread_mutex_lock(&devices_lock);
+    release_device(dev);
+    pthread_mutex_unlock(&devices_lock);
+
+    return 0;
+}
@@ -16,16 +16,26 @@ defmodule Circuits.SPI.SPIDev do
 
   defstruct [:ref]
 
+  @spi_dev_mode System.get_env("CIRCUITS_SPI_SPIDEV")
+
+  # Switching between the stub and simulator changes bus_names/1
+  @doc false
+  def __mix_recompile__?(), do: System.get_env("CIRCUITS_SPI_SPIDEV") != @spi_dev_mode
+
   @doc """
   Return the SPI bus names on this system
 
   No supported options
   """
-  case System.get_env("CIRCUITS_SPI_SPIDEV") do
+  case @spi_dev_mode do
     "test" ->
       @impl Backend
       def bus_names(_options), do: ["spidev0.0"]
 
+    "sim" ->
+      @impl Backend
+      def bus_names(_options), do: ["spidev0.0", "sim_mcp3008", "sim_flash", "sim_regs"]
+
     "normal" ->
       @impl Backend
       def bus_names(_options) do
@@ -0,0 +1,37 @@
+#include "spi_nif.h"
+#include <time.h>
+static uint64_t now(){struct timespec t;clock_gettime(CLOCK_MONOTONIC,&t);return t.tv_sec*1000000000ULL+t.tv_nsec;}
+int main(){
+  char err[128]; struct SpiConfig c={0,8,1000000,0,0,0,0};
+  int a=hal_spi_open("/dev/sim_mcp3008",&c,err);
+  for(int ch=0;ch<8;ch++){uint8_t w[3]={1,0x80|(ch<<4),0},r[3];hal_spi_transfer(a,&c,w,r,3);printf("ch%d=%d ",ch,((r[1]&3)<<8)|r[2]);}
+  // differential ch0-ch1 (config 000) and 001
+  {uint8_t w[3]={1,0x00,0},r[3];hal_spi_transfer(a,&c,w,r,3);printf("\ndiff0=%d ",((r[1]&3)<<8)|r[2]);}
+  {uint8_t w[3]={1,0x10,0},r[3];hal_spi_transfer(a,&c,w,r,3);printf("diff1=%d\n",((r[1]&3)<<8)|r[2]);}
+  // 4-byte LSB-first trailing read
+  {uint8_t w[4]={1,0xA0,0,0},r[4];hal_spi_transfer(a,&c,w,r,4);printf("ch2 bytes %02x %02x %02x %02x\n",r[0],r[1],r[2],r[3]);}
+  // Timing of small ioctls
+  struct SpiConfig f={0,8,10000000,0,0,0,0}; int l=hal_spi_open("/dev/spidev0.0",&f,err);
+  uint8_t b[4]={0};uint64_t s=now();for(int i=0;i<1000;i++)hal_spi_transfer(l,&f,b,b,4);
+  printf("1000x4B @10MHz: %.1f us/ioctl (model: %.1f)\n",(now()-s)/1000.0/1000,20+3.2);
+  // flash
+  int fl=hal_spi_open("/dev/sim_flash",&c,err);
+  uint8_t wren=6; hal_spi_transfer(fl,&c,&wren,NULL,1);
+  uint8_t pp[8]={2,0,0x10,0,'h','i'}; hal_spi_transfer(fl,&c,pp,NULL,6);
+  uint8_t st[2]={5,0},sr[2]; hal_spi_transfer(fl,&c,st,sr,2); printf("status after pp=%02x\n",sr[1]);
+  // WREN while busy then wait
+  int polls=0; do{hal_spi_transfer(fl,&c,st,sr,2);polls++;}while(sr[1]&1); printf("polls=%d status=%02x\n",polls,sr[1]);
+  uint8_t rd[6]={3,0,0x10,0,0,0},rr[6]; hal_spi_transfer(fl,&c,rd,rr,6); printf("read %c%c\n",rr[4],rr[5]);
+  // program 1 over existing bits: AND semantics
+  hal_spi_transfer(fl,&c,&wren,NULL,1); uint8_t pp2[5]={2,0,0x10,0,0xff}; hal_spi_transfer(fl,&c,pp2,NULL,5);
+  do{hal_spi_transfer(fl,&c,st,sr,2);}while(sr[1]&1); hal_spi_transfer(fl,&c,rd,rr,6); printf("after ff program %c\n",rr[4]);
+  // sector erase timing
+  hal_spi_transfer(fl,&c,&wren,NULL,1); uint8_t se[4]={0x20,0,0x10,0}; s=now(); hal_spi_transfer(fl,&c,se,NULL,4);
+  do{hal_spi_transfer(fl,&c,st,sr,2);}while(sr[1]&1); printf("erase %.1f ms\n",(now()-s)/1e6); hal_spi_transfer(fl,&c,rd,rr,6); printf("after erase %02x\n",rr[4]);
+  // close/reopen loses state
+  hal_spi_close(fl); hal_spi_close(a); hal_spi_close(l);
+  // bad fd
+  printf("bad fd %d\n", hal_spi_transfer(99,&c,b,b,1));
+  // len 0
+  int l2=hal_spi_open("/dev/x",&f,err); printf("len0 %d\n",hal_spi_transfer(l2,&f,NULL,NULL,0));
+  return 0;}
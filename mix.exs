@@ -80,7 +80,14 @@ defmodule Circuits.SPI.MixProject do
   end
 
   defp default_backend(), do: default_backend(Mix.env(), Mix.target())
-  defp default_backend(:test, _target), do: {Circuits.SPI.SPIDev, test: true}
+
+  # Run `CIRCUITS_SPI_SPIDEV=sim mix test` to test against the simulator
+  defp default_backend(:test, _target) do
+    case System.get_env("CIRCUITS_SPI_SPIDEV") do
+      "sim" -> {Circuits.SPI.SPIDev, sim: true}
+      _ -> {Circuits.SPI.SPIDev, test: true}
+    end
+  end
 
   defp default_backend(_env, :host) do
     case :os.type() do
@@ -110,10 +117,11 @@ defmodule Circuits.SPI.MixProject do
   end
 
   defp spi_dev_compile_mode({Circuits.SPI.SPIDev, options}) do
-    if Keyword.get(options, :test) do
-      "test"
-    else
-      "normal"
+    case {Keyword.get(options, :test), Keyword.get(options, :sim)} do
+      {true, true} -> Mix.raise("Circuits.SPI.SPIDev options :test and :sim can't both be set")
+      {true, _} -> "test"
+      {_, true} -> "sim"
+      _ -> "normal"
     end
   end
 
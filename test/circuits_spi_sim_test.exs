@@ -0,0 +1,160 @@
+# SPDX-FileCopyrightText: 2026 agent
+#
+# SPDX-License-Identifier: Apache-2.0
+
+defmodule CircuitsSPISimTest do
+  use ExUnit.Case
+
+  @moduletag :sim
+
+  defp read_adc(spi, channel) do
+    {:ok, <<_, _::6, value::10>>} =
+      Circuits.SPI.transfer(spi, <<0x01, 0x80 + channel * 16, 0>>)
+
+    value
+  end
+
+  defp flash_busy?(spi) do
+    {:ok, <<_, status>>} = Circuits.SPI.transfer(spi, <<0x05, 0>>)
+    Bitwise.band(status, 1) == 1
+  end
+
+  defp wait_flash(spi, timeout_ms \\ 1000) do
+    deadline = System.monotonic_time(:millisecond) + timeout_ms
+    do_wait_flash(spi, deadline)
+  end
+
+  defp do_wait_flash(spi, deadline) do
+    cond do
+      not flash_busy?(spi) -> :ok
+      System.monotonic_time(:millisecond) > deadline -> flunk("flash stuck busy")
+      true -> do_wait_flash(spi, deadline)
+    end
+  end
+
+  test "bus time follows speed and delay" do
+    {:ok, spi} = Circuits.SPI.open("spidev0.0", speed_hz: 1_000_000, delay_us: 10)
+    before = Circuits.SPI.info()
+
+    {:ok, _} = Circuits.SPI.transfer(spi, :binary.copy(<<0>>, 1000))
+
+    info = Circuits.SPI.info()
+    assert info.ioctls - before.ioctls == 1
+    assert info.bus_time_us - before.bus_time_us == 8010
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "large transfers are split at bufsiz" do
+    {:ok, spi} = Circuits.SPI.open("spidev0.0")
+    bufsiz = Circuits.SPI.info().bufsiz
+    data = :binary.copy(<<1, 2, 3>>, bufsiz) <> <<4>>
+    before = Circuits.SPI.info()
+
+    assert {:ok, ^data} = Circuits.SPI.transfer(spi, data)
+    assert Circuits.SPI.info().ioctls - before.ioctls == 4
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "small transfers take the modeled wall clock time" do
+    {:ok, spi} = Circuits.SPI.open("spidev0.0", speed_hz: 10_000_000, delay_us: 0)
+    count = 500
+
+    {elapsed_us, _} =
+      :timer.tc(fn ->
+        for _ <- 1..count, do: {:ok, _} = Circuits.SPI.transfer(spi, <<1, 2, 3, 4>>)
+      end)
+
+    # 32 bits at 10 MHz is 3.2 us on the wire
+    expected_us = count * (Circuits.SPI.info().ioctl_overhead_us + 3.2)
+    assert elapsed_us >= expected_us
+    assert elapsed_us < expected_us * 2
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "chip selects on the same bus wait for each other" do
+    {:ok, spi1} = Circuits.SPI.open("spidev0.0", speed_hz: 1_000_000, delay_us: 0)
+    {:ok, spi2} = Circuits.SPI.open("spidev0.1", speed_hz: 1_000_000, delay_us: 0)
+    data = :binary.copy(<<0>>, 2500)
+
+    {elapsed_us, _} =
+      :timer.tc(fn ->
+        [spi1, spi2]
+        |> Enum.map(fn spi -> Task.async(fn -> Circuits.SPI.transfer(spi, data) end) end)
+        |> Task.await_many()
+      end)
+
+    # Each transfer takes 20 ms on the wire
+    assert elapsed_us >= 40_000
+
+    Circuits.SPI.close(spi1)
+    Circuits.SPI.close(spi2)
+  end
+
+  test "mcp3008 returns channel readings" do
+    {:ok, spi} = Circuits.SPI.open("sim_mcp3008")
+
+    for channel <- 0..7 do
+      assert read_adc(spi, channel) == channel * 128
+    end
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "flash programs and reads back" do
+    {:ok, spi} = Circuits.SPI.open("sim_flash")
+
+    assert {:ok, <<_, 0xEF, 0x40, 0x14>>} = Circuits.SPI.transfer(spi, <<0x9F, 0, 0, 0>>)
+
+    :ok = Circuits.SPI.write(spi, <<0x06>>)
+    :ok = Circuits.SPI.write(spi, <<0x02, 0x00, 0x10, 0x00, "hello">>)
+    wait_flash(spi)
+
+    assert {:ok, <<_::4-bytes, "hello", 0xFF>>} =
+             Circuits.SPI.transfer(spi, <<0x03, 0x00, 0x10, 0x00, 0::48>>)
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "flash reports busy while erasing" do
+    {:ok, spi} = Circuits.SPI.open("sim_flash")
+
+    :ok = Circuits.SPI.write(spi, <<0x06>>)
+    :ok = Circuits.SPI.write(spi, <<0x02, 0x00, 0x20, 0x00, 0>>)
+    wait_flash(spi)
+
+    # Sector erases take 45 ms
+    :ok = Circuits.SPI.write(spi, <<0x06>>)
+    :ok = Circuits.SPI.write(spi, <<0x20, 0x00, 0x20, 0x00>>)
+    assert flash_busy?(spi)
+    wait_flash(spi)
+
+    assert {:ok, <<_::4-bytes, 0xFF>>} = Circuits.SPI.transfer(spi, <<0x03, 0x00, 0x20, 0x00, 0>>)
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "flash ignores programs without write enable" do
+    {:ok, spi} = Circuits.SPI.open("sim_flash")
+
+    :ok = Circuits.SPI.write(spi, <<0x02, 0, 0, 0, 0>>)
+    refute flash_busy?(spi)
+    assert {:ok, <<_::4-bytes, 0xFF>>} = Circuits.SPI.transfer(spi, <<0x03, 0, 0, 0, 0>>)
+
+    Circuits.SPI.close(spi)
+  end
+
+  test "register file is shared by handles to the same device" do
+    {:ok, spi1} = Circuits.SPI.open("sim_regs")
+    {:ok, spi2} = Circuits.SPI.open("sim_regs")
+
+    :ok = Circuits.SPI.write(spi1, <<0x10, 1, 2, 3>>)
+    assert {:ok, <<_, 1, 2, 3>>} = Circuits.SPI.transfer(spi2, <<0x90, 0, 0, 0>>)
+    assert {:ok, <<_, 0x5A>>} = Circuits.SPI.transfer(spi2, <<0x80, 0>>)
+
+    Circuits.SPI.close(spi1)
+    Circuits.SPI.close(spi2)
+  end
+end
@@ -4,4 +4,7 @@
 #
 # SPDX-License-Identifier: Apache-2.0
 
-ExUnit.start()
+# Simulator tests need the NIF built with `CIRCUITS_SPI_SPIDEV=sim`
+exclude = if Circuits.SPI.info()[:name] == :sim, do: [], else: [:sim]
+
+ExUnit.start(exclude: exclude)